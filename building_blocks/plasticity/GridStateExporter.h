@@ -0,0 +1,132 @@
+#ifndef PABB_GRID_STATE_EXPORTER_H
+#define PABB_GRID_STATE_EXPORTER_H
+
+#include <cstring>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <utility>
+
+#include "base/vector.h"
+
+#include "GridStateFormat.h"
+
+/// Writes grid state blocks (see GridStateFormat.h) to file on a background thread.
+/// Usage: GetBuffer(), fill it in using GetLayout(), then Submit() it. At most MAX_PENDING blocks are
+/// ever in flight; GetBuffer() waits on the writer if the simulation gets that far ahead.
+/// If a write fails (e.g. disk full), the writer stops writing and Submit() returns false from then on.
+class GridStateExporter {
+public:
+  using buffer_t = emp::vector<unsigned char>;
+
+  static constexpr size_t MAX_PENDING = 4;
+
+protected:
+  GridStateLayout layout;
+  std::ofstream out;
+
+  std::deque<buffer_t> pending;       ///< Filled blocks waiting to be written.
+  emp::vector<buffer_t> free_buffers; ///< Written blocks, ready for reuse.
+  size_t num_buffers;                 ///< Buffers handed out so far (never exceeds MAX_PENDING).
+  bool done;
+  bool failed;                        ///< Has a write to file failed?
+
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::thread writer;
+
+  void WriteLoop() {
+    std::unique_lock<std::mutex> lock(mtx);
+    while (true) {
+      cv.wait(lock, [this]() { return done || !pending.empty(); });
+      if (pending.empty()) return;  // Done and nothing left to write.
+      buffer_t buffer(std::move(pending.front()));
+      pending.pop_front();
+      const bool skip = failed;
+      lock.unlock();
+      // Flush each block so that errors (e.g. disk full) surface now rather than at close.
+      const bool ok = skip || (out.write(reinterpret_cast<const char *>(buffer.data()), (std::streamsize)buffer.size()) && out.flush());
+      lock.lock();
+      if (!ok) failed = true;
+      free_buffers.emplace_back(std::move(buffer));
+      cv.notify_all();
+    }
+  }
+
+public:
+  GridStateExporter(const std::string & fpath, size_t width, size_t height)
+    : layout(width * height), out(fpath, std::ios::binary), pending(), free_buffers(),
+      num_buffers(0), done(false), failed(false), mtx(), cv(), writer() {
+    GridStateFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "PABBGRID", sizeof(header.magic));
+    header.version = GridStateFileHeader::VERSION;
+    header.width = (uint32_t)width;
+    header.height = (uint32_t)height;
+    header.num_fields = (uint32_t)GridStateLayout::NUM_FIELDS;
+    header.block_size = (uint64_t)layout.block_size;
+    if (!out.write(reinterpret_cast<const char *>(&header), sizeof(header))) failed = true;
+    writer = std::thread([this]() { this->WriteLoop(); });
+  }
+
+  GridStateExporter(const GridStateExporter &) = delete;
+  GridStateExporter & operator=(const GridStateExporter &) = delete;
+
+  /// Flushes all submitted blocks before returning.
+  ~GridStateExporter() {
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      done = true;
+    }
+    cv.notify_all();
+    writer.join();
+    out.close();
+    if (failed || out.fail()) std::cerr << "Failed to write grid state output; dump is incomplete." << std::endl;
+  }
+
+  /// Was the output file opened (and its header written) successfully?
+  bool IsOpen() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return out.is_open() && !failed;
+  }
+
+  const GridStateLayout & GetLayout() const { return layout; }
+
+  /// Get a zeroed buffer sized for one block.
+  buffer_t GetBuffer() {
+    std::unique_lock<std::mutex> lock(mtx);
+    if (free_buffers.empty() && num_buffers < MAX_PENDING) {
+      ++num_buffers;
+      lock.unlock();
+      return buffer_t(layout.block_size, 0);
+    }
+    cv.wait(lock, [this]() { return !free_buffers.empty(); });
+    buffer_t buffer(std::move(free_buffers.back()));
+    free_buffers.pop_back();
+    lock.unlock();
+    std::memset(buffer.data(), 0, buffer.size());
+    return buffer;
+  }
+
+  /// Hand filled block over to the writer thread.
+  /// Returns false (and drops the block) if an earlier write has failed.
+  bool Submit(buffer_t && buffer) {
+    emp_assert(buffer.size() == layout.block_size);
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      if (failed) {
+        free_buffers.emplace_back(std::move(buffer));
+        return false;
+      }
+      pending.emplace_back(std::move(buffer));
+    }
+    cv.notify_all();
+    return true;
+  }
+};
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef PABB_GRID_STATE_FORMAT_H
+#define PABB_GRID_STATE_FORMAT_H
+
+// On-disk layout of grid state dumps (see GridStateExporter.h & GridStateReader.h).
+//
+// File:  [GridStateFileHeader][block 0][block 1]...
+// Block: [GridStateBlockHeader][column 0][column 1]...[padding to 8 bytes]
+//   * Every block has the same size, so block k lives at sizeof(GridStateFileHeader) + k * block_size.
+//   * Each column holds one fixed-width value per cell (cell id = x + y * width), stored contiguously.
+//   * Columns are ordered widest first so that every column is naturally aligned within a block.
+//   * Values are written in host byte order.
+
+#include <cstddef>
+#include <cstdint>
+
+#include "base/assert.h"
+
+struct GridStateFileHeader {
+  static constexpr uint32_t VERSION = 1;
+
+  char magic[8];        ///< "PABBGRID"
+  uint32_t version;     ///< Format version.
+  uint32_t width;       ///< Grid width.
+  uint32_t height;      ///< Grid height.
+  uint32_t num_fields;  ///< Number of columns per block.
+  uint64_t block_size;  ///< Size (in bytes) of every block, header included.
+};
+
+struct GridStateBlockHeader {
+  uint64_t update;      ///< Update at which grid state was captured.
+  uint64_t reserved;
+};
+
+/// Column offsets for a grid of a given size.
+struct GridStateLayout {
+  static constexpr size_t FIELD__GENOTYPE_ID = 0;     ///< uint32: Genotype (systematics) id. Only meaningful where occupied.
+  static constexpr size_t FIELD__RES = 1;             ///< float: Resources collected by occupant.
+  static constexpr size_t FIELD__RES_MOD = 2;         ///< float: Occupant's resource modifier.
+  static constexpr size_t FIELD__MSGS_DROPPED = 3;    ///< uint32: Messages dropped from occupant's inbox.
+  static constexpr size_t FIELD__MSGS_COALESCED = 4;  ///< uint32: Messages coalesced in occupant's inbox.
+  static constexpr size_t FIELD__ENV_STATE = 5;       ///< uint8: Environment state of cell.
+  static constexpr size_t FIELD__OCCUPIED = 6;        ///< uint8: Is cell occupied? (1/0)
+  static constexpr size_t FIELD__DIR = 7;             ///< uint8: Direction occupant is facing.
+  static constexpr size_t FIELD__LAST_EXPORT = 8;     ///< int8: Occupant's most recent export (-1 if nothing exported).
+  static constexpr size_t NUM_FIELDS = 9;
+
+  size_t num_cells;
+  size_t offsets[NUM_FIELDS];
+  size_t block_size;
+
+  GridStateLayout(size_t _num_cells = 0) : num_cells(_num_cells), offsets(), block_size(0) {
+    size_t offset = sizeof(GridStateBlockHeader);
+    for (size_t field = 0; field < NUM_FIELDS; ++field) {
+      offsets[field] = offset;
+      offset += GetFieldWidth(field) * num_cells;
+    }
+    block_size = (offset + 7) & ~(size_t)7;
+  }
+
+  /// Bytes per cell used by field.
+  static size_t GetFieldWidth(size_t field) {
+    switch (field) {
+      case FIELD__GENOTYPE_ID:    return sizeof(uint32_t);
+      case FIELD__RES:            return sizeof(float);
+      case FIELD__RES_MOD:        return sizeof(float);
+      case FIELD__MSGS_DROPPED:   return sizeof(uint32_t);
+      case FIELD__MSGS_COALESCED: return sizeof(uint32_t);
+      case FIELD__ENV_STATE:      return sizeof(uint8_t);
+      case FIELD__OCCUPIED:       return sizeof(uint8_t);
+      case FIELD__DIR:            return sizeof(uint8_t);
+      case FIELD__LAST_EXPORT:    return sizeof(int8_t);
+    }
+    return 0;
+  }
+
+  GridStateBlockHeader * GetHeader(unsigned char * block) const {
+    return reinterpret_cast<GridStateBlockHeader *>(block);
+  }
+
+  const GridStateBlockHeader * GetHeader(const unsigned char * block) const {
+    return reinterpret_cast<const GridStateBlockHeader *>(block);
+  }
+
+  /// Get column for field within block. T must match the field's width.
+  template <typename T>
+  T * GetColumn(unsigned char * block, size_t field) const {
+    emp_assert(field < NUM_FIELDS && sizeof(T) == GetFieldWidth(field));
+    return reinterpret_cast<T *>(block + offsets[field]);
+  }
+
+  template <typename T>
+  const T * GetColumn(const unsigned char * block, size_t field) const {
+    emp_assert(field < NUM_FIELDS && sizeof(T) == GetFieldWidth(field));
+    return reinterpret_cast<const T *>(block + offsets[field]);
+  }
+};
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef PABB_GRID_STATE_READER_H
+#define PABB_GRID_STATE_READER_H
+
+#include <cstring>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "base/vector.h"
+
+#include "GridStateFormat.h"
+
+/// Read-only, zero-copy view of a grid state dump (see GridStateFormat.h).
+/// The file is memory mapped; columns are returned as pointers straight into the mapping and stay
+/// valid for the lifetime of the reader. A trailing partial block (e.g. from an interrupted run) is ignored.
+class GridStateReader {
+protected:
+  int fd;
+  size_t file_size;
+  const unsigned char * data;
+  GridStateFileHeader header;
+  GridStateLayout layout;
+  size_t num_blocks;
+
+  const unsigned char * GetBlock(size_t block) const {
+    emp_assert(block < num_blocks);
+    return data + sizeof(GridStateFileHeader) + block * layout.block_size;
+  }
+
+  void Close() {
+    if (data) munmap(const_cast<unsigned char *>(data), file_size);
+    if (fd >= 0) close(fd);
+    fd = -1;
+    file_size = 0;
+    data = nullptr;
+    num_blocks = 0;
+  }
+
+public:
+  GridStateReader(const std::string & fpath)
+    : fd(-1), file_size(0), data(nullptr), header(), layout(), num_blocks(0) {
+    fd = open(fpath.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(GridStateFileHeader)) { Close(); return; }
+    file_size = (size_t)st.st_size;
+    void * mapped = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) { Close(); return; }
+    data = static_cast<const unsigned char *>(mapped);
+    std::memcpy(&header, data, sizeof(header));
+    layout = GridStateLayout((size_t)header.width * (size_t)header.height);
+    if (std::memcmp(header.magic, "PABBGRID", sizeof(header.magic)) != 0
+        || header.version != GridStateFileHeader::VERSION
+        || header.num_fields != GridStateLayout::NUM_FIELDS
+        || header.block_size != layout.block_size) { Close(); return; }
+    num_blocks = (file_size - sizeof(GridStateFileHeader)) / layout.block_size;
+  }
+
+  GridStateReader(const GridStateReader &) = delete;
+  GridStateReader & operator=(const GridStateReader &) = delete;
+
+  ~GridStateReader() { Close(); }
+
+  /// Was the file opened and recognized as a grid state dump?
+  bool IsOpen() const { return data != nullptr; }
+
+  size_t GetWidth() const { return header.width; }
+  size_t GetHeight() const { return header.height; }
+  size_t GetNumCells() const { return layout.num_cells; }
+  size_t GetNumBlocks() const { return num_blocks; }
+  const GridStateLayout & GetLayout() const { return layout; }
+
+  /// Update at which block was captured.
+  size_t GetUpdate(size_t block) const { return (size_t)layout.GetHeader(GetBlock(block))->update; }
+
+  /// Index of first block captured at or after update (GetNumBlocks() if there is none).
+  /// Blocks are written in update order, so this is a binary search.
+  size_t LowerBound(size_t update) const {
+    size_t lo = 0;
+    size_t hi = num_blocks;
+    while (lo < hi) {
+      const size_t mid = lo + (hi - lo) / 2;
+      if (GetUpdate(mid) < update) lo = mid + 1;
+      else hi = mid;
+    }
+    return lo;
+  }
+
+  /// Index of block captured exactly at update (GetNumBlocks() if there is none).
+  size_t FindBlock(size_t update) const {
+    const size_t block = LowerBound(update);
+    return (block < num_blocks && GetUpdate(block) == update) ? block : num_blocks;
+  }
+
+  /// Get entire column of field in block (GetNumCells() values, cell id = x + y * width).
+  /// T must match the field's width (see GridStateLayout).
+  template <typename T>
+  const T * GetColumn(size_t block, size_t field) const {
+    return layout.GetColumn<T>(GetBlock(block), field);
+  }
+
+  /// Get pointer to row y of field in block (GetWidth() values).
+  template <typename T>
+  const T * GetRow(size_t block, size_t field, size_t y) const {
+    emp_assert(y < header.height);
+    return GetColumn<T>(block, field) + y * header.width;
+  }
+
+  template <typename T>
+  T GetValue(size_t block, size_t field, size_t x, size_t y) const {
+    emp_assert(x < header.width);
+    return GetRow<T>(block, field, y)[x];
+  }
+
+  /// Copy rectangular region [x, x+w) x [y, y+h) of field in block into out (row-major, w * h values).
+  template <typename T>
+  void GetRegion(size_t block, size_t field, size_t x, size_t y, size_t w, size_t h, emp::vector<T> & out) const {
+    emp_assert(x + w <= header.width && y + h <= header.height);
+    out.resize(w * h);
+    for (size_t row = 0; row < h; ++row) {
+      const T * src = GetRow<T>(block, field, y + row) + x;
+      std::memcpy(out.data() + row * w, src, w * sizeof(T));
+    }
+  }
+};
+
+#endif
@@ -31,7 +31,11 @@ EMP_BUILD_CONFIG( MajorTransConfig,
   VALUE(PER_FUNC__FUNC_DEL_RATE, double, 0.05, "."),
   VALUE(SYSTEMATICS_INTERVAL, size_t, 100, "."),
   VALUE(POP_SNAPSHOT_INTERVAL, size_t, 100000, "."),
-  VALUE(DATA_DIRECTORY, std::string, "./", ".")
+  VALUE(GRID_STATE_INTERVAL, size_t, 0, "How often (in updates) should per-cell grid state be dumped to grid_state.bin? (0 for never; native builds only)"),
+  VALUE(DATA_DIRECTORY, std::string, "./", "."),
+  GROUP(MESSAGING_GROUP, "Message Inbox Settings"),
+  VALUE(INBOX_CAPACITY, size_t, 8, "Maximum number of messages that can wait in an organism's inbox."),
+  VALUE(INBOX_POLICY, size_t, 0, "How are incoming messages queued? (0: when full, drop oldest; 1: when full, drop newest; 2: always overwrite a waiting message with identical affinity, otherwise when full, drop oldest)")
 )
 
 #endif
@@ -22,6 +22,7 @@
 #include "Evo/World.h"
 
 #include "PABBConfig.h"
+#include "GridStateExporter.h"
 
 using hardware_t = emp::EventDrivenGP;
 using state_t = emp::EventDrivenGP::State;
@@ -81,6 +82,10 @@ protected:
   static constexpr size_t DIR_DOWN = 2;
   static constexpr size_t DIR_RIGHT = 3;
 
+  static constexpr size_t INBOX_POLICY__DROP_OLDEST = 0;  ///< Full inbox: drop oldest queued message.
+  static constexpr size_t INBOX_POLICY__DROP_NEWEST = 1;  ///< Full inbox: drop incoming message.
+  static constexpr size_t INBOX_POLICY__COALESCE = 2;     ///< Incoming message overwrites queued message w/same affinity.
+
   // == Configurable variables: ==
   // General settings.
   int RAND_SEED;
@@ -115,9 +120,14 @@ protected:
   double PER_FUNC__FUNC_DUP_RATE;
   double PER_FUNC__FUNC_DEL_RATE;
 
+  // Message inboxes.
+  size_t INBOX_CAPACITY;
+  size_t INBOX_POLICY;
+
   // Output info.
   size_t SYSTEMATICS_INTERVAL;
   size_t POP_SNAPSHOT_INTERVAL;
+  size_t GRID_STATE_INTERVAL;
   std::string DATA_DIR;
 
   MajorTransConfig config;
@@ -135,14 +145,38 @@ protected:
   emp::vector<size_t> schedule;
   emp::vector<char> scheduled;
 
+  // Dormancy: organisms that cannot affect anything outside themselves until they get a message are
+  // left off the awake list until something (a message, a reset) gives them work again (see IsDormant).
+  // Resources are credited lazily.
+  emp::vector<char> inst_has_effect;  ///< Can instruction (by id) affect anything beyond core-local memory?
+  emp::vector<char> main_inert;       ///< Is organism's main function (function 0) free of such instructions?
+  emp::vector<size_t> awake;          ///< Organisms that get CPU cycles (subset of schedule).
+  emp::vector<char> is_awake;
+  emp::vector<size_t> res_credit_ud;  ///< First update each organism has not yet been given resources for.
+  size_t res_credit_clock;            ///< First update a freshly reset organism is owed resources for.
+
   std::deque<Birth> birth_queue;
 
+  emp::Ptr<GridStateExporter> grid_state_exporter;
+
+  // Message inboxes: each cell owns INBOX_CAPACITY consecutive slots of inbox_buffer, used as a ring.
+  emp::vector<event_t> inbox_buffer;
+  emp::vector<size_t> inbox_head;       ///< Slot offset of oldest message in each cell's inbox.
+  emp::vector<size_t> inbox_count;      ///< Number of messages waiting in each cell's inbox.
+  emp::vector<size_t> inbox_dropped;    ///< Messages dropped per organism (reset on ResetOrg).
+  emp::vector<size_t> inbox_coalesced;  ///< Messages coalesced per organism (reset on ResetOrg).
+  size_t total_dropped;
+  size_t total_coalesced;
+
 public:
   PABB_Ancestral(int argc, char* argv[], const std::string & _config_fname)
     : RAND_SEED(0), GRID_WIDTH(0), GRID_HEIGHT(0), GRID_SIZE(0), UPDATES(0),
       ANCESTOR_FPATH(),
       config(), random(), affinity_table(256), env_state_affs(), env_states(),
-      inst_lib(), event_lib(), world(), schedule(), scheduled() {
+      inst_lib(), event_lib(), world(), schedule(), scheduled(),
+      inst_has_effect(), main_inert(), awake(), is_awake(), res_credit_ud(), res_credit_clock(0), birth_queue(), grid_state_exporter(),
+      inbox_buffer(), inbox_head(), inbox_count(), inbox_dropped(), inbox_coalesced(),
+      total_dropped(0), total_coalesced(0) {
 
     // Read configs.
     config.Read(_config_fname);
@@ -180,14 +214,32 @@ public:
     PER_FUNC__SLIP_RATE = config.PER_FUNC__SLIP_RATE();
     PER_FUNC__FUNC_DUP_RATE = config.PER_FUNC__FUNC_DUP_RATE();
     PER_FUNC__FUNC_DEL_RATE = config.PER_FUNC__FUNC_DEL_RATE();
+    INBOX_CAPACITY = config.INBOX_CAPACITY();
+    INBOX_POLICY = config.INBOX_POLICY();
     SYSTEMATICS_INTERVAL = config.SYSTEMATICS_INTERVAL();
     POP_SNAPSHOT_INTERVAL = config.POP_SNAPSHOT_INTERVAL();
+    GRID_STATE_INTERVAL = config.GRID_STATE_INTERVAL();
     DATA_DIR = config.DATA_DIRECTORY();
 
     // Setup output directory.
     mkdir(DATA_DIR.c_str(), ACCESSPERMS);
     if (DATA_DIR.back() != '/') DATA_DIR += '/';
 
+    // Setup grid state output (written on a background thread).
+#ifdef __EMSCRIPTEN__
+    if (GRID_STATE_INTERVAL) {
+      std::cout << "Grid state output needs threads; GRID_STATE_INTERVAL is not supported in web builds. Exiting..." << std::endl;
+      exit(-1);
+    }
+#endif
+    if (GRID_STATE_INTERVAL) {
+      grid_state_exporter = emp::NewPtr<GridStateExporter>(DATA_DIR + "grid_state.bin", GRID_WIDTH, GRID_HEIGHT);
+      if (!grid_state_exporter->IsOpen()) {
+        std::cout << "Failed to open grid state output file. Exiting..." << std::endl;
+        exit(-1);
+      }
+    }
+
     // Create random number generator.
     random = emp::NewPtr<emp::Random>(RAND_SEED);
 
@@ -202,6 +254,20 @@ public:
 
     // Setup schedule management
     scheduled.resize(GRID_SIZE, 0);
+    main_inert.resize(GRID_SIZE, 0);
+    is_awake.resize(GRID_SIZE, 0);
+    res_credit_ud.resize(GRID_SIZE, 0);
+
+    // Setup message inboxes.
+    if (INBOX_POLICY > INBOX_POLICY__COALESCE) {
+      std::cout << "Unknown INBOX_POLICY (" << INBOX_POLICY << "). Exiting..." << std::endl;
+      exit(-1);
+    }
+    inbox_buffer.resize(GRID_SIZE * INBOX_CAPACITY);
+    inbox_head.resize(GRID_SIZE, 0);
+    inbox_count.resize(GRID_SIZE, 0);
+    inbox_dropped.resize(GRID_SIZE, 0);
+    inbox_coalesced.resize(GRID_SIZE, 0);
 
     // Setup instruction set.
     inst_lib = emp::NewPtr<inst_lib_t>();
@@ -248,6 +314,15 @@ public:
     inst_lib->AddInst("SendMsg", Inst_SendMsg, 1, "Send output memory as message event to neighbor specified by local memory Arg1.", emp::ScopeType::BASIC, 0, {"affinity"});
     inst_lib->AddInst("BindEnv", [this](hardware_t & hw, const inst_t & inst) { this->Inst_BindEnv(hw, inst); }, 0, "Bind environment to appropriate function.");
 
+    // Instructions that reach beyond core-local memory (traits, environment, other organisms, shared
+    // memory, other functions). A main function without any of these cannot do anything observable.
+    inst_has_effect.resize(inst_lib->GetSize(), 0);
+    for (const char * name : {"Call", "Commit", "Pull", "Repro", "Export0", "Export1", "Export2",
+                              "RotCW", "RotCCW", "RotDir", "SendMsgFacing", "SendMsgRandom",
+                              "SendMsg", "BindEnv"}) {
+      inst_has_effect[inst_lib->GetID(name)] = 1;
+    }
+
     // Setup the event library.
     event_lib = emp::NewPtr<event_lib_t>(*emp::EventDrivenGP::DefaultEventLib());
     event_lib->RegisterDispatchFun("Message", [this](hardware_t & hw, const event_t & event){ this->DispatchMessage(hw, event); });
@@ -288,6 +363,7 @@ public:
   }
 
   ~PABB_Ancestral() {
+    if (grid_state_exporter) grid_state_exporter.Delete(); // Flushes outstanding grid state.
     world.Delete();
     inst_lib.Delete();
     event_lib.Delete();
@@ -377,6 +453,12 @@ public:
     org.SetTrait(TRAIT_ID__RES_MOD, 1);
     org.SetTrait(TRAIT_ID__EXPORTED, 0);
     org.SetTrait(TRAIT_ID__REPRODUCED, 0);
+    ClearInbox(id);                         // Messages to previous occupant are discarded.
+    inbox_dropped[id] = 0;
+    inbox_coalesced[id] = 0;
+    res_credit_ud[id] = res_credit_clock;   // Start accruing resources from here.
+    main_inert[id] = IsInert(org.GetProgram(), 0);
+    Wake(id);
   }
 
   void Schedule(size_t id) {
@@ -385,6 +467,99 @@ public:
     scheduled[id] = 1;
   }
 
+  /// Put organism back on the list of organisms that receive CPU cycles.
+  void Wake(size_t id) {
+    if (is_awake[id]) return;
+    awake.emplace_back(id);
+    is_awake[id] = 1;
+  }
+
+  /// Is function fID in program free of instructions that affect anything beyond core-local memory?
+  bool IsInert(program_t & program, size_t fID) const {
+    if (fID >= program.GetSize()) return true;
+    function_t & function = program[fID];
+    for (size_t i = 0; i < function.GetSize(); ++i) {
+      if (inst_has_effect[function[i].id]) return false;
+    }
+    return true;
+  }
+
+  /// Organism is dormant if nothing is waiting in its inbox and the only core it could be running is
+  /// its main core running an inert main function. The main core restarts whenever its function
+  /// ends, so it is always active; running it only shuffles core-local memory around until a
+  /// message spawns a new core, which wakes the organism.
+  bool IsDormant(size_t id) {
+    if (inbox_count[id]) return false;
+    const size_t active_cores = world->GetOrg(id).GetActiveCores().size();
+    return active_cores == 0 || (active_cores == 1 && main_inert[id]);
+  }
+
+  /// How many updates' worth of resources is organism owed (as of the start of update)?
+  size_t GetOwedUpdates(size_t id, size_t update) const {
+    return (update > res_credit_ud[id]) ? update - res_credit_ud[id] : 0;
+  }
+
+  /// Give organism the resources it has accrued before update.
+  void CreditResources(size_t id, size_t update) {
+    world->GetOrg(id).IncTrait(TRAIT_ID__RES, (double)GetOwedUpdates(id, update));
+    res_credit_ud[id] = emp::Max(res_credit_ud[id], update);
+  }
+
+  /// Give out organism's CPU cycle for this update.
+  void ProcessOrg(size_t id, size_t update) {
+    org_t & org = world->GetOrg(id);
+    org.SetTrait(TRAIT_ID__EXPORTED, 0);
+    org.SetTrait(TRAIT_ID__REPRODUCED, 0);
+    CreditResources(id, update + 1);  // Give out resources (including any owed from dormancy).
+    DeliverInbox(id);                 // Hand over waiting messages.
+    world->ProcessID(id, 1); // Call Process(num_inst = 1)
+  }
+
+  /// Get message in id's inbox at position i (0 is oldest).
+  event_t & GetInboxMsg(size_t id, size_t i) {
+    return inbox_buffer[id * INBOX_CAPACITY + (inbox_head[id] + i) % INBOX_CAPACITY];
+  }
+
+  void ClearInbox(size_t id) {
+    inbox_head[id] = 0;
+    inbox_count[id] = 0;
+  }
+
+  /// Put message into id's inbox, applying the configured inbox policy.
+  void DepositMessage(size_t id, const event_t & event) {
+    size_t & count = inbox_count[id];
+    if (INBOX_POLICY == INBOX_POLICY__COALESCE) {
+      // Overwrite waiting message with identical affinity (keeps its place in line).
+      for (size_t i = 0; i < count; ++i) {
+        event_t & waiting = GetInboxMsg(id, i);
+        if (waiting.affinity == event.affinity) {
+          waiting = event;
+          ++inbox_coalesced[id];
+          ++total_coalesced;
+          return;
+        }
+      }
+    }
+    if (count >= INBOX_CAPACITY) {
+      ++inbox_dropped[id];
+      ++total_dropped;
+      if (INBOX_POLICY == INBOX_POLICY__DROP_NEWEST || INBOX_CAPACITY == 0) return;
+      // Make room by dropping the oldest message.
+      inbox_head[id] = (inbox_head[id] + 1) % INBOX_CAPACITY;
+      --count;
+    }
+    GetInboxMsg(id, count) = event;
+    ++count;
+    Wake(id);
+  }
+
+  /// Move everything waiting in id's inbox into the organism's event queue (oldest first).
+  void DeliverInbox(size_t id) {
+    org_t & org = world->GetOrg(id);
+    for (size_t i = 0; i < inbox_count[id]; ++i) org.QueueEvent(GetInboxMsg(id, i));
+    ClearInbox(id);
+  }
+
   /// Mutate organism function.
   /// Return number of mutation *events* that occur (e.g. function duplication, slip mutation are single events).
   size_t Mutate(org_t & hw, emp::Random & rnd) {
@@ -468,19 +643,21 @@ public:
 
   // ============== Running the experiment. ==============
   void OnUpdate(size_t update) {
-    std::cout << "Update: " << update <<  "  Pop size: " << schedule.size() << "  Ave depth: " << world->GetSystematics().GetAveDepth() << std::endl;
+    std::cout << "Update: " << update <<  "  Pop size: " << schedule.size() << "  Active: " << awake.size() << "  Ave depth: " << world->GetSystematics().GetAveDepth()
+              << "  Msgs dropped: " << total_dropped << "  Msgs coalesced: " << total_coalesced << std::endl;
     // Randomize schedule.
-    Shuffle(*random, schedule);
-    // Give out CPU cycles to everyone on the schedule.
+    Shuffle(*random, awake);
+    // Give out CPU cycles to everyone awake.
     // Note: Loop structure relies on overflowing size_t i. When hits -1, will be max size_t.
-    for (size_t i = schedule.size() - 1; i < schedule.size(); --i) {
-      size_t id = schedule[i];
-      org_t & org = world->GetOrg(id);
-      org.SetTrait(TRAIT_ID__EXPORTED, 0);
-      org.SetTrait(TRAIT_ID__REPRODUCED, 0);
-      org.IncTrait(TRAIT_ID__RES);  // Give out resources.
-      world->ProcessID(id, 1); // Call Process(num_inst = 1)
+    const size_t num_scheduled = awake.size();
+    for (size_t i = num_scheduled - 1; i < num_scheduled; --i) {
+      ProcessOrg(awake[i], update);
+    }
+    // Organisms woken by messages during the loop were appended to awake; they still get this update's cycle.
+    for (size_t i = num_scheduled; i < awake.size(); ++i) {
+      ProcessOrg(awake[i], update);
     }
+    res_credit_clock = update + 1;
     // Process birth queue.
     while (!birth_queue.empty()) {
       Birth & birth = birth_queue.front(); // Who's next?
@@ -488,6 +665,14 @@ public:
       ResetOrg(birth.src_id);
       birth_queue.pop_front();
     }
+    // Put organisms with nothing left to do to sleep.
+    size_t num_awake = 0;
+    for (size_t i = 0; i < awake.size(); ++i) {
+      const size_t id = awake[i];
+      if (IsDormant(id)) { is_awake[id] = 0; continue; }
+      awake[num_awake++] = id;
+    }
+    awake.resize(num_awake);
     // std::cout << "Press anything to continue..." << std::endl;
     // std::string x;
     // std::cin >> x;
@@ -507,15 +692,52 @@ public:
     }
   }
 
+  /// Capture per-cell grid state for this update and hand it off to the grid state exporter.
+  void DumpGridState(size_t update) {
+    const GridStateLayout & layout = grid_state_exporter->GetLayout();
+    GridStateExporter::buffer_t block = grid_state_exporter->GetBuffer();
+    unsigned char * data = block.data();
+    layout.GetHeader(data)->update = update;
+    uint32_t * genotype_ids = layout.GetColumn<uint32_t>(data, GridStateLayout::FIELD__GENOTYPE_ID);
+    float * res = layout.GetColumn<float>(data, GridStateLayout::FIELD__RES);
+    float * res_mod = layout.GetColumn<float>(data, GridStateLayout::FIELD__RES_MOD);
+    uint32_t * msgs_dropped = layout.GetColumn<uint32_t>(data, GridStateLayout::FIELD__MSGS_DROPPED);
+    uint32_t * msgs_coalesced = layout.GetColumn<uint32_t>(data, GridStateLayout::FIELD__MSGS_COALESCED);
+    uint8_t * env = layout.GetColumn<uint8_t>(data, GridStateLayout::FIELD__ENV_STATE);
+    uint8_t * occupied = layout.GetColumn<uint8_t>(data, GridStateLayout::FIELD__OCCUPIED);
+    uint8_t * dir = layout.GetColumn<uint8_t>(data, GridStateLayout::FIELD__DIR);
+    int8_t * last_export = layout.GetColumn<int8_t>(data, GridStateLayout::FIELD__LAST_EXPORT);
+    for (size_t i = 0; i < GRID_SIZE; ++i) {
+      env[i] = (uint8_t)env_states[i];
+      if (!world->IsOccupied(i)) continue;
+      org_t & org = world->GetOrg(i);
+      occupied[i] = 1;
+      genotype_ids[i] = (uint32_t)world->GetGenotypeAt(i)->GetID();
+      // Include resources dormant organisms have accrued but not yet been credited.
+      res[i] = (float)(org.GetTrait(TRAIT_ID__RES) + (double)GetOwedUpdates(i, res_credit_clock));
+      res_mod[i] = (float)org.GetTrait(TRAIT_ID__RES_MOD);
+      msgs_dropped[i] = (uint32_t)inbox_dropped[i];
+      msgs_coalesced[i] = (uint32_t)inbox_coalesced[i];
+      dir[i] = (uint8_t)org.GetTrait(TRAIT_ID__DIR);
+      last_export[i] = (int8_t)org.GetTrait(TRAIT_ID__LAST_EXPORT);
+    }
+    if (!grid_state_exporter->Submit(std::move(block))) {
+      std::cout << "Failed to write grid state output. Exiting..." << std::endl;
+      exit(-1);
+    }
+  }
+
   void Run() {
     // Run Evolution.
     for (size_t ud = 0; ud < UPDATES; ++ud) {
       world->Update();
       if (ud % POP_SNAPSHOT_INTERVAL == 0) Snapshot(ud);
+      if (GRID_STATE_INTERVAL && ud % GRID_STATE_INTERVAL == 0) DumpGridState(ud);
     }
     // Print everything out.
     for (size_t i = schedule.size() - 1; i < schedule.size(); --i) {
       size_t id = schedule[i];
+      CreditResources(id, res_credit_clock);  // Settle up dormant organisms before printing.
       std::cout << "-------------------------------------------------------" << std::endl;
       std::cout << "Printing... " << id << std::endl;
       std::cout << " " << "{id: " << schedule[i] << ", mc: " << world->GetOrg(schedule[i]).GetMaxCores() << "}" << std::endl;
@@ -543,6 +765,8 @@ public:
   ///   * Msg types that need to be dispatched:
   ///     * send - On a send message event, dispatch to neighbor given by hw.GetTrait(TRAIT_ID__MSG_DIR)
   ///     * broadcast -- On a broadcast message event, dispatch message to all neighbors.
+  ///   * Messages land in the recipient's bounded inbox (see DepositMessage) and are handed to the
+  ///     recipient's hardware at the start of its next turn.
   void DispatchMessage(hardware_t & hw, const event_t & event) {
     const size_t sender_x = (size_t)hw.GetTrait(TRAIT_ID__X_LOC);
     const size_t sender_y = (size_t)hw.GetTrait(TRAIT_ID__Y_LOC);
@@ -552,7 +776,7 @@ public:
       const Loc pos = GetFacing(sender_x, sender_y, dir);
       // Queue up the message.
       const size_t rID = GetID(pos.x, pos.y);
-      if (world->IsOccupied(rID)) world->GetOrg(rID).QueueEvent(event);
+      if (world->IsOccupied(rID)) DepositMessage(rID, event);
     } else {
       const Loc u_pos = GetFacing(sender_x, sender_y, DIR_UP);
       const Loc d_pos = GetFacing(sender_x, sender_y, DIR_DOWN);
@@ -563,10 +787,10 @@ public:
       const size_t rID1 = GetID(d_pos.x, d_pos.y);
       const size_t rID2 = GetID(r_pos.x, r_pos.y);
       const size_t rID3 = GetID(l_pos.x, l_pos.y);
-      if (world->IsOccupied(rID0)) world->GetOrg(rID0).QueueEvent(event);
-      if (world->IsOccupied(rID1)) world->GetOrg(rID1).QueueEvent(event);
-      if (world->IsOccupied(rID2)) world->GetOrg(rID2).QueueEvent(event);
-      if (world->IsOccupied(rID3)) world->GetOrg(rID3).QueueEvent(event);
+      if (world->IsOccupied(rID0)) DepositMessage(rID0, event);
+      if (world->IsOccupied(rID1)) DepositMessage(rID1, event);
+      if (world->IsOccupied(rID2)) DepositMessage(rID2, event);
+      if (world->IsOccupied(rID3)) DepositMessage(rID3, event);
     }
   }
 
@@ -0,0 +1,103 @@
+// Round-trip check for grid state dumps: write with GridStateExporter, read back with GridStateReader.
+
+#include <string>
+#include <iostream>
+#include <cstdio>
+
+#include "base/vector.h"
+
+#include "GridStateExporter.h"
+#include "GridStateReader.h"
+
+static size_t failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { ++failures; std::cout << "FAILED (line " << __LINE__ << "): " #cond << std::endl; } } while (0)
+
+/// Deterministic per-cell values so the reader side can recompute what was written.
+static uint32_t GenotypeAt(size_t update, size_t cell) { return (uint32_t)(update * 1000 + cell); }
+static float ResAt(size_t update, size_t cell) { return (float)update + 0.5f * (float)cell; }
+
+int main() {
+  const std::string fpath = "test__grid_state.bin";
+  const size_t width = 7;
+  const size_t height = 5;
+  const size_t interval = 10;
+  const size_t num_dumps = 12;  // More than GridStateExporter::MAX_PENDING, so buffers get recycled.
+
+  // Write.
+  {
+    GridStateExporter exporter(fpath, width, height);
+    CHECK(exporter.IsOpen());
+    const GridStateLayout & layout = exporter.GetLayout();
+    for (size_t k = 0; k < num_dumps; ++k) {
+      const size_t update = k * interval;
+      GridStateExporter::buffer_t block = exporter.GetBuffer();
+      unsigned char * data = block.data();
+      layout.GetHeader(data)->update = update;
+      uint32_t * genotype_ids = layout.GetColumn<uint32_t>(data, GridStateLayout::FIELD__GENOTYPE_ID);
+      float * res = layout.GetColumn<float>(data, GridStateLayout::FIELD__RES);
+      uint32_t * msgs_dropped = layout.GetColumn<uint32_t>(data, GridStateLayout::FIELD__MSGS_DROPPED);
+      uint8_t * occupied = layout.GetColumn<uint8_t>(data, GridStateLayout::FIELD__OCCUPIED);
+      int8_t * last_export = layout.GetColumn<int8_t>(data, GridStateLayout::FIELD__LAST_EXPORT);
+      for (size_t i = 0; i < width * height; ++i) {
+        genotype_ids[i] = GenotypeAt(update, i);
+        res[i] = ResAt(update, i);
+        msgs_dropped[i] = (uint32_t)(k + i);
+        occupied[i] = (uint8_t)(i % 2);
+        last_export[i] = -1;
+      }
+      CHECK(exporter.Submit(std::move(block)));
+    }
+  } // Exporter flushes on destruction.
+
+  // Read.
+  {
+    GridStateReader reader(fpath);
+    CHECK(reader.IsOpen());
+    CHECK(reader.GetWidth() == width);
+    CHECK(reader.GetHeight() == height);
+    CHECK(reader.GetNumBlocks() == num_dumps);
+
+    // FindBlock / LowerBound.
+    CHECK(reader.FindBlock(0) == 0);
+    CHECK(reader.FindBlock(40) == 4);
+    CHECK(reader.FindBlock(41) == reader.GetNumBlocks());
+    CHECK(reader.LowerBound(41) == 5);
+    CHECK(reader.LowerBound(num_dumps * interval) == reader.GetNumBlocks());
+
+    // Whole columns.
+    for (size_t block = 0; block < reader.GetNumBlocks(); ++block) {
+      const size_t update = reader.GetUpdate(block);
+      CHECK(update == block * interval);
+      const uint32_t * genotype_ids = reader.GetColumn<uint32_t>(block, GridStateLayout::FIELD__GENOTYPE_ID);
+      const uint32_t * msgs_dropped = reader.GetColumn<uint32_t>(block, GridStateLayout::FIELD__MSGS_DROPPED);
+      const uint8_t * occupied = reader.GetColumn<uint8_t>(block, GridStateLayout::FIELD__OCCUPIED);
+      for (size_t i = 0; i < width * height; ++i) {
+        CHECK(genotype_ids[i] == GenotypeAt(update, i));
+        CHECK(msgs_dropped[i] == (uint32_t)(block + i));
+        CHECK(occupied[i] == (uint8_t)(i % 2));
+      }
+    }
+    CHECK(reader.GetValue<int8_t>(3, GridStateLayout::FIELD__LAST_EXPORT, 6, 4) == -1);
+    CHECK(reader.GetValue<float>(3, GridStateLayout::FIELD__RES, 2, 1) == ResAt(30, 2 + 1 * width));
+
+    // Region slice.
+    emp::vector<float> region;
+    const size_t block = reader.FindBlock(70);
+    reader.GetRegion<float>(block, GridStateLayout::FIELD__RES, 2, 1, 3, 2, region);
+    CHECK(region.size() == 6);
+    for (size_t row = 0; row < 2; ++row) {
+      for (size_t col = 0; col < 3; ++col) {
+        CHECK(region[row * 3 + col] == ResAt(70, (2 + col) + (1 + row) * width));
+      }
+    }
+  }
+
+  std::remove(fpath.c_str());
+  if (failures) {
+    std::cout << failures << " check(s) failed." << std::endl;
+    return 1;
+  }
+  std::cout << "Grid state round trip OK." << std::endl;
+  return 0;
+}